@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "container.h"
+
+static uint32_t checksum(uint8_t* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for(size_t i=0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t payload_size(int block_count)
+{
+    return ((size_t) block_count * CONTAINER_BITS_PER_BLOCK + 7) / 8 + CONTAINER_PADDING;
+}
+
+uint8_t is_file_container(char* filename)
+{
+    size_t len = strlen(filename);
+    size_t ext_len = strlen(CONTAINER_EXTENSION);
+    return len > ext_len && !strcmp(filename + len - ext_len, CONTAINER_EXTENSION);
+}
+
+// Loads a container made for the same k as this job, since its blocks were packed for that k
+image_t load_container(char* filename, int k)
+{
+    image_t image;
+    image.file = NULL;
+    image.packed = NULL;
+
+    FILE* in = fopen(filename, "rb");
+    if(in == NULL)
+        return image;
+    fseek(in, 0, SEEK_END);
+    long len = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    uint8_t* file = NULL;
+    if(len >= CONTAINER_HEADER_SIZE && (file = malloc(len)) != NULL && fread(file, 1, len, in) != (size_t) len)
+    {
+        free(file);
+        file = NULL;
+    }
+    fclose(in);
+    if(file == NULL)
+        return image;
+
+    int header_size = read_little_endian_int(file+24);
+    int block_count = read_little_endian_int(file+20);
+    if(memcmp(file, CONTAINER_MAGIC, 4) != 0 || file[4] != CONTAINER_VERSION || header_size < 0 || block_count < 0
+        || (size_t) len != CONTAINER_HEADER_SIZE + header_size + payload_size(block_count)
+        || (uint32_t) read_little_endian_int(file+28) != checksum(file + CONTAINER_HEADER_SIZE, len - CONTAINER_HEADER_SIZE))
+    {
+        fprintf(stderr, "ERROR. Container %s is corrupted.\n", filename);
+        free(file);
+        return image;
+    }
+
+    int width = read_little_endian_int(file+8);
+    int height = read_little_endian_int(file+12);
+    if(file[5] != k || block_count != (height*width)/k)
+    {
+        fprintf(stderr, "ERROR. Container %s was made for k=%d, but this job uses k=%d.\n", filename, file[5], k);
+        free(file);
+        return image;
+    }
+
+    image.filename = filename;
+    image.width = width;
+    image.height = height;
+    image.real_width = read_little_endian_int(file+16);
+    image.content = NULL;
+    image.packed = file + CONTAINER_HEADER_SIZE + header_size;
+    image.file = file;
+    return image;
+}
+
+// Saves the recovery payload of a shadow as <dir_name>/<shadow name>.ssp
+int save_container(image_t image, int id, int k, char* dir_name)
+{
+    char* slash = strrchr(image.filename, '/');
+    char* base = slash == NULL ? image.filename : slash + 1;
+    char filename[strlen(dir_name) + strlen(base) + strlen(CONTAINER_EXTENSION) + 2];
+    sprintf(filename, "%s/%.*s%s", dir_name, (int) strlen(base) - 4, base, CONTAINER_EXTENSION);
+
+    int block_count = (image.height*image.width)/k;
+    int header_size = image.content - (uint8_t*) image.file;
+    size_t body_size = header_size + payload_size(block_count);
+    uint8_t* container = calloc(CONTAINER_HEADER_SIZE + body_size, sizeof(uint8_t));
+    memcpy(container, CONTAINER_MAGIC, 4);
+    container[4] = CONTAINER_VERSION;
+    container[5] = k;
+    container[6] = id & 0xFF;
+    container[7] = (id >> 8) & 0xFF;
+    write_little_endian_int(container+8, image.width);
+    write_little_endian_int(container+12, image.height);
+    write_little_endian_int(container+16, image.real_width);
+    write_little_endian_int(container+20, block_count);
+    write_little_endian_int(container+24, header_size);
+    memcpy(container + CONTAINER_HEADER_SIZE, image.file, header_size);
+
+    uint8_t* stream = container + CONTAINER_HEADER_SIZE + header_size;
+    for(int j=0; j < block_count; j++)
+    {
+        int X_block = xwvu_block_offset(image, j);
+        uint32_t value = image.content[X_block] << 9 | (image.content[X_block + 1] & 0x07) << 6
+            | (image.content[X_block - image.width] & 0x07) << 3 | (image.content[X_block - image.width + 1] & 0x07);
+        long bit = (long) j * CONTAINER_BITS_PER_BLOCK;
+        uint32_t window = value << (24 - CONTAINER_BITS_PER_BLOCK - bit % 8);
+        stream[bit/8] |= window >> 16;
+        stream[bit/8 + 1] |= (window >> 8) & 0xFF;
+        stream[bit/8 + 2] |= window & 0xFF;
+    }
+    write_little_endian_int(container+28, checksum(container + CONTAINER_HEADER_SIZE, body_size));
+
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "ERROR. Container %s could not be created.\n", filename);
+        free(container);
+        return EXIT_FAILURE;
+    }
+    fwrite(container, sizeof(uint8_t), CONTAINER_HEADER_SIZE + body_size, file);
+    fclose(file);
+    free(container);
+    return EXIT_SUCCESS;
+}
+
+// Fills xwvu with the X byte and the low bits of W, V and U of block j. The high bits of W, V and U are 0.
+void unpack_xwvu_block(image_t image, int j, uint8_t* xwvu)
+{
+    long bit = (long) j * CONTAINER_BITS_PER_BLOCK;
+    uint8_t* bytes = image.packed + bit/8;
+    uint32_t window = bytes[0] << 16 | bytes[1] << 8 | bytes[2];
+    uint32_t value = (window >> (24 - CONTAINER_BITS_PER_BLOCK - bit % 8)) & 0x1FFFF;
+    xwvu[0] = value >> 9;
+    xwvu[1] = (value >> 6) & 0x07;
+    xwvu[2] = (value >> 3) & 0x07;
+    xwvu[3] = value & 0x07;
+}
+
+// Builds an empty BMP with the dimensions and palette of the picture a container was made from
+image_t blank_image_from_container(image_t container)
+{
+    image_t image = container;
+    uint8_t* header = (uint8_t*) container.file + CONTAINER_HEADER_SIZE;
+    int header_size = read_little_endian_int((uint8_t*) container.file + 24);
+    uint8_t* file = calloc(read_little_endian_int(header+2), sizeof(uint8_t));
+    memcpy(file, header, header_size);
+    image.file = file;
+    image.content = file + read_little_endian_int(file+10);
+    image.packed = NULL;
+    return image;
+}
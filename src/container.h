@@ -0,0 +1,24 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+#include <stdint.h>
+#include <dirent.h>
+#include "image.h"
+#define CONTAINER_MAGIC "SSPK"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 32
+#define CONTAINER_EXTENSION ".ssp"
+#define CONTAINER_BITS_PER_BLOCK 17 // X and the low 3 bits of W, V and U
+#define CONTAINER_PADDING 2 // Lets every block be read with a single 3 byte window
+
+// A container holds only what recovery needs from a shadow:
+// header | original BMP header and palette | X, W, V, U bits of every block, in block order, packed MSB first
+// The header is CONTAINER_MAGIC, version, k, shadow id (2 bytes), width, height, real width, block count,
+// BMP header size and a FNV-1a checksum of everything after the header, all little endian.
+
+uint8_t is_file_container(char* filename);
+image_t load_container(char* filename, int k);
+int save_container(image_t image, int id, int k, char* dir_name);
+void unpack_xwvu_block(image_t image, int j, uint8_t* xwvu);
+image_t blank_image_from_container(image_t container);
+
+#endif
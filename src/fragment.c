@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "fragment.h"
+
+static int fragment_unit(enum fragment_kind kind, int k)
+{
+    return kind == SHADOW_FRAGMENT ? 4 : k;
+}
+
+// Fragments for <target> are saved next to it as <target>.<first>-<last>.frag
+int save_fragment(char* target, enum fragment_kind kind, image_t image, int k, int first, int count, uint8_t* payload)
+{
+    char filename[strlen(target) + 32];
+    sprintf(filename, "%s.%d-%d%s", target, first, first + count, FRAGMENT_EXTENSION);
+
+    uint8_t header[FRAGMENT_HEADER_SIZE] = {0};
+    memcpy(header, FRAGMENT_MAGIC, 4);
+    header[4] = kind;
+    header[5] = k;
+    write_little_endian_int(header+8, image.width);
+    write_little_endian_int(header+12, image.height);
+    write_little_endian_int(header+16, first);
+    write_little_endian_int(header+20, count);
+
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "ERROR. Fragment %s could not be created.\n", filename);
+        return EXIT_FAILURE;
+    }
+    fwrite(header, sizeof(uint8_t), FRAGMENT_HEADER_SIZE, file);
+    fwrite(payload, sizeof(uint8_t), count * fragment_unit(kind, k), file);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+// Saves the XWVU blocks of every shadow, once transformed in memory, as one fragment per shadow
+int save_shadow_fragments(image_t* pictures, int k, int n, int first, int count)
+{
+    uint8_t* payload = calloc(count*4, sizeof(uint8_t));
+    int status = EXIT_SUCCESS;
+    for(int i=0; i < n && status == EXIT_SUCCESS; i++)
+    {
+        for(int j=0; j < count; j++)
+        {
+            int X_block = xwvu_block_offset(pictures[i], first + j);
+            payload[4*j] = pictures[i].content[X_block];
+            payload[4*j + 1] = pictures[i].content[X_block + 1];
+            payload[4*j + 2] = pictures[i].content[X_block - pictures[i].width];
+            payload[4*j + 3] = pictures[i].content[X_block - pictures[i].width + 1];
+        }
+        status = save_fragment(pictures[i].filename, SHADOW_FRAGMENT, pictures[i], k, first, count, payload);
+    }
+    free(payload);
+    return status;
+}
+
+static uint8_t* load_fragment(char* filename, size_t* size)
+{
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* data = NULL;
+    if(len >= FRAGMENT_HEADER_SIZE && (data = malloc(len)) != NULL)
+    {
+        if(fread(data, 1, len, file) == (size_t) len)
+            *size = len;
+        else
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+// Copies the blocks held by a fragment into image
+// Returns -1 if the fragment doesn't belong to this job, -2 if it overlaps blocks another fragment already covered
+static int apply_fragment(uint8_t* fragment, size_t size, enum fragment_kind kind, image_t image, int k, uint8_t* covered)
+{
+    int block_count = (image.height*image.width)/k;
+    int unit = fragment_unit(kind, k);
+    int first = read_little_endian_int(fragment+16);
+    int count = read_little_endian_int(fragment+20);
+    if(memcmp(fragment, FRAGMENT_MAGIC, 4) != 0 || fragment[4] != kind || fragment[5] != k
+        || read_little_endian_int(fragment+8) != image.width || read_little_endian_int(fragment+12) != image.height
+        || first < 0 || count < 0 || first + count > block_count
+        || size != FRAGMENT_HEADER_SIZE + (size_t) count * unit)
+        return -1;
+    for(int j=0; j < count; j++)
+        if(covered[first + j])
+            return -2;
+
+    uint8_t* payload = fragment + FRAGMENT_HEADER_SIZE;
+    if(kind == SECRET_FRAGMENT)
+        memcpy(image.content + first*k, payload, count*k);
+    for(int j=0; j < count; j++)
+    {
+        if(kind == SHADOW_FRAGMENT)
+        {
+            int X_block = xwvu_block_offset(image, first + j);
+            image.content[X_block] = payload[4*j];
+            image.content[X_block + 1] = payload[4*j + 1];
+            image.content[X_block - image.width] = payload[4*j + 2];
+            image.content[X_block - image.width + 1] = payload[4*j + 3];
+        }
+        covered[first + j] = 1;
+    }
+    return count;
+}
+
+// Splits target into the directory its fragments are in and its name
+static char* split_target(char* target, char* dir_name)
+{
+    char* slash = strrchr(target, '/');
+    if(slash == NULL)
+        strcpy(dir_name, ".");
+    else
+    {
+        strncpy(dir_name, target, slash - target);
+        dir_name[slash - target] = '\0';
+    }
+    return slash == NULL ? target : slash + 1;
+}
+
+// Returns 1 if name is <base>.<anything>.frag
+static int is_fragment_of(char* name, char* base)
+{
+    size_t len = strlen(name);
+    size_t base_len = strlen(base);
+    size_t ext_len = strlen(FRAGMENT_EXTENSION);
+    return len > base_len + ext_len && strncmp(name, base, base_len) == 0 && name[base_len] == '.'
+        && strcmp(name + len - ext_len, FRAGMENT_EXTENSION) == 0;
+}
+
+// Applies every fragment of <target> found in its directory to image
+// Returns the amount of distinct blocks covered, or -1 if a fragment was invalid or overlapped another one
+int merge_fragments(char* target, enum fragment_kind kind, image_t image, int k)
+{
+    char dir_name[strlen(target) + 2];
+    char* base = split_target(target, dir_name);
+    DIR* dir = opendir(dir_name);
+    if(dir == NULL)
+    {
+        fprintf(stderr, "ERROR. Directory %s could not be opened.\n", dir_name);
+        return -1;
+    }
+
+    int block_count = (image.height*image.width)/k;
+    uint8_t* covered = calloc(block_count, sizeof(uint8_t));
+    int result = 0;
+    struct dirent* in_file;
+    while (result >= 0 && (in_file = readdir(dir)))
+    {
+        if(!is_fragment_of(in_file->d_name, base))
+            continue;
+        char filename[strlen(dir_name) + strlen(in_file->d_name) + 2];
+        sprintf(filename, "%s/%s", dir_name, in_file->d_name);
+        size_t size;
+        uint8_t* fragment = load_fragment(filename, &size);
+        int applied = fragment == NULL ? -1 : apply_fragment(fragment, size, kind, image, k, covered);
+        if(applied == -1)
+            fprintf(stderr, "ERROR. Fragment %s is corrupted or belongs to another job.\n", filename);
+        else if(applied == -2)
+            fprintf(stderr, "ERROR. Fragment %s overlaps another fragment of %s. Remove the fragments of previous jobs.\n", filename, target);
+        if(applied < 0)
+            result = -1;
+        free(fragment);
+    }
+    closedir(dir);
+
+    if(result == 0)
+        for(int j=0; j < block_count; j++)
+            result += covered[j];
+    free(covered);
+    return result;
+}
+
+// Deletes every fragment of <target>, once they've been merged and saved
+void remove_fragments(char* target)
+{
+    char dir_name[strlen(target) + 2];
+    char* base = split_target(target, dir_name);
+    DIR* dir = opendir(dir_name);
+    if(dir == NULL)
+        return;
+    struct dirent* in_file;
+    while ((in_file = readdir(dir)))
+    {
+        if(!is_fragment_of(in_file->d_name, base))
+            continue;
+        char filename[strlen(dir_name) + strlen(in_file->d_name) + 2];
+        sprintf(filename, "%s/%s", dir_name, in_file->d_name);
+        if(remove(filename) != 0)
+            fprintf(stderr, "WARNING. Fragment %s could not be removed.\n", filename);
+    }
+    closedir(dir);
+}
@@ -0,0 +1,20 @@
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+#include <stdint.h>
+#include <dirent.h>
+#include "image.h"
+#define FRAGMENT_MAGIC "SSFG"
+#define FRAGMENT_HEADER_SIZE 24
+#define FRAGMENT_EXTENSION ".frag"
+
+// A fragment holds the result of processing blocks first..first+count-1 of a job
+// SHADOW_FRAGMENT stores the 4 XWVU bytes of every block of one shadow
+// SECRET_FRAGMENT stores the k recovered pixels of every block of the secret
+enum fragment_kind{SHADOW_FRAGMENT, SECRET_FRAGMENT};
+
+int save_fragment(char* target, enum fragment_kind kind, image_t image, int k, int first, int count, uint8_t* payload);
+int save_shadow_fragments(image_t* pictures, int k, int n, int first, int count);
+int merge_fragments(char* target, enum fragment_kind kind, image_t image, int k);
+void remove_fragments(char* target);
+
+#endif
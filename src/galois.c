@@ -8,6 +8,8 @@
 
 uint8_t** matrix = NULL;
 uint8_t* inverses = NULL;
+uint8_t* powers = NULL; // powers[x*power_degree + i] = x^i
+int power_degree = 0;
 
 uint8_t galois_sum(uint8_t a, uint8_t b) {
 	return a ^ b;
@@ -53,6 +55,32 @@ uint8_t galois_inverse(uint8_t x)
     return inverses[x];
 }
 
+// Inverts every value in place using Montgomery's trick: a single inversion plus 3(count-1) multiplications
+// Zeros have no inverse, so they're skipped and left as 0 without poisoning the rest of the batch
+void galois_batch_inverse(uint8_t* values, int count)
+{
+    if(count <= 0)
+        return;
+    uint8_t prefix[count];
+    uint8_t acc = 1;
+    for(int i=0; i < count; i++)
+    {
+        if(values[i] != 0)
+            acc = galois_multiply(acc, values[i]);
+        prefix[i] = acc;
+    }
+    uint8_t inv = galois_inverse(acc);
+    for(int i=count-1; i >= 0; i--)
+    {
+        if(values[i] == 0)
+            continue;
+        uint8_t previous = (i > 0) ? prefix[i-1] : 1;
+        uint8_t value_inv = galois_multiply(inv, previous);
+        inv = galois_multiply(inv, values[i]);
+        values[i] = value_inv;
+    }
+}
+
 // Inverso = n es inverso de m y viceversa si n*m = 1
 void load_multiplication_table()
 {
@@ -93,6 +121,27 @@ void free_multiplication_table()
     free(inverses);
 }
 
+// X is a single byte, so x^i for every possible X and every coefficient of F fits in a 256*k table
+void load_power_table(int k)
+{
+    free_power_table();
+    powers = calloc(256*k, sizeof(uint8_t));
+    power_degree = k;
+    for(int x=0; x < 256; x++)
+    {
+        powers[x*k] = 1;
+        for(int i=1; i < k; i++)
+            powers[x*k + i] = galois_multiply(powers[x*k + i-1], x);
+    }
+}
+
+void free_power_table()
+{
+    free(powers);
+    powers = NULL;
+    power_degree = 0;
+}
+
 void print_multiplication_table()
 {
     printf("  |\t");
@@ -117,6 +166,13 @@ void print_inverses()
 uint8_t F(uint8_t x, uint8_t* s, int k)
 {
 	int result = 0;
+	if(powers != NULL && k <= power_degree)
+	{
+		uint8_t* x_powers = powers + x*power_degree;
+		for(int i=0; i < k; i++)
+			result = galois_sum(result, galois_multiply(s[i], x_powers[i]));
+		return result;
+	}
 	for(int i=0; i < k; i++)
 	{
 		int aux = s[i];
@@ -168,9 +224,90 @@ int T_inverse(uint8_t* xwvu)
 	uint8_t number = first_three | middle_three | last_two;
 	uint8_t parity = (xwvu[3] & 0x04) >> 2;
 	if(parity != parity_bit(number))
-	{
-		fprintf(stderr, "ERROR. One of the images is corrupted.\n");
 		return -1;
-	}
 	return number;
 }
+
+// Berlekamp-Welch decoding: finds the polynomial of degree k-1 that goes through all m points except for at most (m-k)/2 of them
+// Solves Q(Xi) = Yi*E(Xi) for Q of degree e+k-1 and the monic error locator E of degree e, and then divides Q by E.
+// Returns 0 and fills polynomial with k coefficients on success, -1 if there were too many errors.
+int berlekamp_welch(uint8_t* X, uint8_t* Y, int m, int k, uint8_t* polynomial)
+{
+	int e = (m - k) / 2;
+	int unknowns = 2*e + k; // q0..q(e+k-1), then e0..e(e-1)
+	uint8_t system[m][unknowns + 1];
+	for(int row=0; row < m; row++)
+	{
+		uint8_t power = 1;
+		for(int a=0; a < e + k; a++)
+		{
+			system[row][a] = power;
+			if(a < e)
+				system[row][e + k + a] = galois_multiply(Y[row], power);
+			else if(a == e)
+				system[row][unknowns] = galois_multiply(Y[row], power);
+			power = galois_multiply(power, X[row]);
+		}
+	}
+
+	// Gauss-Jordan elimination. Free variables are left as 0, any solution of the system works.
+	int pivot_col[m];
+	int rank = 0;
+	for(int col=0; col < unknowns && rank < m; col++)
+	{
+		int pivot = rank;
+		while(pivot < m && system[pivot][col] == 0)
+			pivot++;
+		if(pivot == m)
+			continue;
+		for(int c=0; c <= unknowns; c++)
+		{
+			uint8_t aux = system[pivot][c];
+			system[pivot][c] = system[rank][c];
+			system[rank][c] = aux;
+		}
+		uint8_t inv = galois_inverse(system[rank][col]);
+		for(int c=0; c <= unknowns; c++)
+			system[rank][c] = galois_multiply(system[rank][c], inv);
+		for(int row=0; row < m; row++)
+		{
+			uint8_t factor = system[row][col];
+			if(row == rank || factor == 0)
+				continue;
+			for(int c=0; c <= unknowns; c++)
+				system[row][c] = galois_sum(system[row][c], galois_multiply(factor, system[rank][c]));
+		}
+		pivot_col[rank++] = col;
+	}
+	for(int row=rank; row < m; row++)
+		if(system[row][unknowns] != 0)
+			return -1;
+
+	uint8_t solution[unknowns];
+	memset(solution, 0, unknowns);
+	for(int row=0; row < rank; row++)
+		solution[pivot_col[row]] = system[row][unknowns];
+
+	// Long division of Q by E, which must leave no remainder
+	uint8_t remainder[e + k];
+	memcpy(remainder, solution, e + k);
+	uint8_t locator[e + 1];
+	memcpy(locator, solution + e + k, e);
+	locator[e] = 1;
+	for(int d=e+k-1; d >= e; d--)
+	{
+		uint8_t coefficient = remainder[d];
+		polynomial[d - e] = coefficient;
+		for(int t=0; t <= e; t++)
+			remainder[d - e + t] = galois_sum(remainder[d - e + t], galois_multiply(coefficient, locator[t]));
+	}
+	for(int d=0; d < e; d++)
+		if(remainder[d] != 0)
+			return -1;
+
+	int mismatches = 0;
+	for(int row=0; row < m; row++)
+		if(F(X[row], polynomial, k) != Y[row])
+			mismatches++;
+	return mismatches <= e ? 0 : -1;
+}
@@ -6,11 +6,15 @@ uint8_t galois_sum(uint8_t a, uint8_t b);
 uint8_t galois_multiply(uint8_t a, uint8_t b);
 uint8_t galois_divide(uint8_t a, uint8_t b);
 uint8_t galois_inverse(uint8_t x);
+void galois_batch_inverse(uint8_t* values, int count);
 uint8_t F(uint8_t x, uint8_t* s, int k);
 void T(uint8_t* xwvu, uint8_t* s, int k);
 int T_inverse(uint8_t* xwvu);
+int berlekamp_welch(uint8_t* X, uint8_t* Y, int m, int k, uint8_t* polynomial);
 void load_multiplication_table();
 void free_multiplication_table();
+void load_power_table(int k);
+void free_power_table();
 void print_multiplication_table();
 void print_inverses();
 
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "image.h"
 #include "galois.h"
+#include "container.h"
 
 static int file_size(FILE* in, size_t* size)
 {
@@ -50,7 +51,15 @@ static void* load_binary(const char* filename, size_t* size)
 
 int read_little_endian_int(uint8_t* bytes)
 {
-    return bytes[0] | (bytes[1]<<8) | (bytes[2]<<16) | (bytes[3]<<24);
+    return bytes[0] | (bytes[1]<<8) | (bytes[2]<<16) | ((uint32_t) bytes[3]<<24);
+}
+
+void write_little_endian_int(uint8_t* bytes, int value)
+{
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
 }
 
 image_t load_image(char* filename)
@@ -76,6 +85,7 @@ image_t load_image(char* filename)
 		if(image.width == 0)
 			image.width = image.real_width;
 		image.content = file + read_little_endian_int(file+10);
+		image.packed = NULL;
 		image.file = file;
 	}
 	else
@@ -139,13 +149,17 @@ int collect_images(DIR* FD, char* dir_name, int k, image_t** pics)
             continue;
         char* filename = get_image_path(dir_name, in_file->d_name);
 
-        // Only load image if it's a bitmap with the right format
-        if(is_file_bmp(filename))
+        // Only load image if it's a bitmap with the right format or a shadow container
+        if(is_file_bmp(filename) || is_file_container(filename))
         {
-            pictures[image_count] = load_image(filename);
+            pictures[image_count] = is_file_bmp(filename) ? load_image(filename) : load_container(filename, k);
             if(pictures[image_count].file != NULL)
                 image_count++;
+            else
+                free(filename);
         }
+        else
+            free(filename);
     }
     // We have found image_count bitmaps. Let's check they're all the same size.
     if(image_count < k)
@@ -197,41 +211,39 @@ void save_file_as(image_t image, char* filename)
     fclose(file);
 }
 
-uint8_t** get_secret_blocks(image_t image, int k)
+// Builds an empty picture with the same header and palette as template, to write a recovered secret into
+image_t blank_image(image_t template)
 {
-    int block_count = (image.height*image.width)/k;
-    uint8_t** blocks = calloc(block_count, sizeof(uint8_t*));
-    for(int j=0; j < block_count; j++)
-    {
-        blocks[j] = calloc(k, sizeof(uint8_t));
-        for(int i=0; i < k; i++)
-        {
-            blocks[j][i] = image.content[j*k + i];
-        }
-    }
-    return blocks;
+    if(template.packed != NULL)
+        return blank_image_from_container(template);
+    uint8_t* file = calloc(read_little_endian_int((uint8_t*) template.file + 2), sizeof(uint8_t));
+    memcpy(file, template.file, template.content - (uint8_t*) template.file);
+    template.file = file;
+    template.content = file + read_little_endian_int(file + 10);
+    return template;
 }
 
-void free_secret_blocks(uint8_t** blocks, image_t image, int k)
+// Returns the position in image.content of the X pixel of the 2x2 tile holding block j
+// Block j always lies in the row-pair stripe 2j/width, so contiguous block ranges map to contiguous stripes
+int xwvu_block_offset(image_t image, int j)
 {
-    int block_count = (image.height*image.width)/k;
-    for(int j=0; j < block_count; j++)
-    {
-        free(blocks[j]);
-    }
-    free(blocks);
+    int x = (2*j % image.width);
+    int y = 2 * (2*j / image.width); // Keep the 2s separate, since a 4j/width could return an odd number, and we don't want that
+    return (image.height-1)*image.width + x - y*image.width;
 }
 
-uint8_t** get_image_xwvu_blocks(image_t image, int k)
+uint8_t** get_image_xwvu_blocks(image_t image, int first, int count)
 {
-    int block_count = (image.height*image.width)/k;
-    uint8_t** blocks = calloc(block_count, sizeof(uint8_t*));
-    for(int j=0; j < block_count; j++)
+    uint8_t** blocks = calloc(count, sizeof(uint8_t*));
+    for(int j=0; j < count; j++)
     {
-        int x = (2*j % image.width);
-        int y = 2 * (2*j / image.width); // Keep the 2s separate, since a 4j/width could return an odd number, and we don't want that
-        int X_block = (image.height-1)*image.width + x - y*image.width;
         blocks[j] = calloc(4, sizeof(uint8_t));
+        if(image.packed != NULL)
+        {
+            unpack_xwvu_block(image, first + j, blocks[j]);
+            continue;
+        }
+        int X_block = xwvu_block_offset(image, first + j);
         blocks[j][0] = image.content[X_block];
         blocks[j][1] = image.content[X_block + 1];
         blocks[j][2] = image.content[X_block - image.width];
@@ -240,16 +252,22 @@ uint8_t** get_image_xwvu_blocks(image_t image, int k)
     return blocks;
 }
 
-uint8_t*** get_xwvu_blocks(image_t* images, int k, int n)
+// Returns album[image][block - first] for blocks first..first+count-1
+uint8_t*** get_xwvu_blocks_range(image_t* images, int n, int first, int count)
 {
     uint8_t*** album = calloc(n, sizeof(uint8_t*));
     for(int i=0; i < n; i++)
     {
-        album[i] = get_image_xwvu_blocks(images[i], k);
+        album[i] = get_image_xwvu_blocks(images[i], first, count);
     }
     return album;
 }
 
+uint8_t*** get_xwvu_blocks(image_t* images, int k, int n)
+{
+    return get_xwvu_blocks_range(images, n, 0, (images[0].height*images[0].width)/k);
+}
+
 // Adjusts all X values in XWVU album so all Xs within a block set are unique
 void adjust_xwvu_blocks(uint8_t*** album, int block_count, int n)
 {
@@ -282,14 +300,31 @@ void transform_xwvu_blocks(uint8_t*** album, uint8_t** polynomials, int block_co
     }
 }
 
-void replace_xwvu_blocks_image(image_t image, uint8_t** xwvu, int k)
+// Applies the F(X) transformation straight to the pictures, using the already unique Xs of a camouflage index
+// xs[image][block] holds the X of every block of the whole picture
+void transform_indexed_blocks(image_t* pictures, uint8_t** xs, uint8_t** polynomials, int k, int n, int first, int count)
 {
-    int block_count = (image.height*image.width)/k;
-    for(int j=0; j < block_count; j++)
+    for(int i=0; i < n; i++)
     {
-        int x = (2*j % image.width);
-        int y = 2 * (2*j / image.width);
-        int X_block = (image.height-1)*image.width + x - y*image.width;
+        image_t image = pictures[i];
+        for(int j=0; j < count; j++)
+        {
+            int X_block = xwvu_block_offset(image, first + j);
+            uint8_t xwvu[4] = {xs[i][first + j], image.content[X_block + 1], image.content[X_block - image.width], image.content[X_block - image.width + 1]};
+            T(xwvu, polynomials[j], k);
+            image.content[X_block] = xwvu[0];
+            image.content[X_block + 1] = xwvu[1];
+            image.content[X_block - image.width] = xwvu[2];
+            image.content[X_block - image.width + 1] = xwvu[3];
+        }
+    }
+}
+
+void replace_xwvu_blocks_image(image_t image, uint8_t** xwvu, int first, int count)
+{
+    for(int j=0; j < count; j++)
+    {
+        int X_block = xwvu_block_offset(image, first + j);
         image.content[X_block] = xwvu[j][0];
         image.content[X_block + 1] = xwvu[j][1];
         image.content[X_block - image.width] = xwvu[j][2];
@@ -297,115 +332,173 @@ void replace_xwvu_blocks_image(image_t image, uint8_t** xwvu, int k)
     }
 }
 
-void replace_xwvu_blocks(uint8_t*** album, image_t* pictures, int k, int n)
+void replace_xwvu_blocks_range(uint8_t*** album, image_t* pictures, int n, int first, int count)
 {
     for(int i=0; i < n; i++)
-        replace_xwvu_blocks_image(pictures[i], album[i], k);
+        replace_xwvu_blocks_image(pictures[i], album[i], first, count);
 }
 
-void free_image_xwvu_blocks(uint8_t** blocks, image_t image, int k)
+void replace_xwvu_blocks(uint8_t*** album, image_t* pictures, int k, int n)
 {
-    int block_count = (image.height*image.width)/k;
-    for(int j=0; j < block_count; j++)
-        free(blocks[j]);
-    free(blocks);
+    replace_xwvu_blocks_range(album, pictures, n, 0, (pictures[0].height*pictures[0].width)/k);
 }
 
-void free_xwvu_blocks(uint8_t*** album, image_t* images, int k, int n)
+void free_xwvu_blocks_range(uint8_t*** album, int n, int count)
 {
-    for(int j=0; j < n; j++)
-        free_image_xwvu_blocks(album[j], images[j], k);
+    for(int i=0; i < n; i++)
+        free_points(album[i], count);
     free(album);
 }
 
-// Returns points[block][image]
-// Use dim=0 if you want values for X
-// Use dim=1 if you want values for Y
-uint8_t** recover_points(image_t* images, int k, int n, int dim)
+void free_xwvu_blocks(uint8_t*** album, image_t* images, int k, int n)
 {
-    dim = dim % 2;
-    uint8_t*** album = get_xwvu_blocks(images, k, n);
-    int block_count = (images[0].height*images[0].width)/k;
-    uint8_t** points = calloc(block_count, sizeof(uint8_t*));
-    for(int j=0; j < block_count; j++)
+    free_xwvu_blocks_range(album, n, (images[0].height*images[0].width)/k);
+}
+
+// Moves the points of a block that agree with polynomial to the front. Returns how many of them there are.
+static int keep_consistent_points(uint8_t* X, uint8_t* Y, int m, uint8_t* polynomial, int k)
+{
+    int kept = 0;
+    for(int i=0; i < m; i++)
     {
-        points[j] = calloc(n, sizeof(uint8_t));
+        if(F(X[i], polynomial, k) != Y[i])
+            continue;
+        uint8_t aux_x = X[kept], aux_y = Y[kept];
+        X[kept] = X[i];
+        Y[kept] = Y[i];
+        X[i] = aux_x;
+        Y[i] = aux_y;
+        kept++;
+    }
+    return kept;
+}
+
+// Recovers the points of blocks first..first+count-1 in a single pass, skipping the ones that fail the parity check
+// or share their X with another shadow, so the first k points of every block are valid ones, wherever they came from.
+// If correct is set and a block has surplus points, the ones F disagrees with are corrected with Berlekamp-Welch.
+// Blocks with less than k valid points, or inconsistent ones that couldn't be corrected, get Y=0 so they're
+// recovered as black. Returns how many there were.
+int recover_valid_points(image_t* images, int k, int n, int first, int count, int correct, uint8_t*** Xs, uint8_t*** Ys)
+{
+    uint8_t*** album = get_xwvu_blocks_range(images, n, first, count);
+    uint8_t** points_X = calloc(count, sizeof(uint8_t*));
+    uint8_t** points_Y = calloc(count, sizeof(uint8_t*));
+    int failed = 0;
+    for(int j=0; j < count; j++)
+    {
+        uint8_t* X = points_X[j] = calloc(n, sizeof(uint8_t));
+        uint8_t* Y = points_Y[j] = calloc(n, sizeof(uint8_t));
+        int valid = 0;
         for(int i=0; i < n; i++)
         {
-            int value;
-            if(dim == 0)
-                value = album[i][j][0];
-            else
-            {
-                value = T_inverse(album[i][j]);
-                if(value < 0)
-                {
-                    for(int a=0; a <=j; a++)
-                        free(points[a]);
-                    free(points);
-                    return NULL;
-                }
-            }
-            points[j][i] = (uint8_t) value;
+            int value = T_inverse(album[i][j]);
+            if(value < 0)
+                continue;
+            X[valid] = album[i][j][0];
+            Y[valid] = (uint8_t) value;
+            valid++;
+        }
+        // Distribution makes every X unique, so a repeated X means one of those shadows is corrupted.
+        // There's no telling which one, so all the points sharing that X are dropped.
+        int unique = 0;
+        for(int i=0; i < valid; i++)
+        {
+            int repeated = 0;
+            for(int index=0; index < valid && !repeated; index++)
+                repeated = (index != i && X[index] == X[i]);
+            if(repeated)
+                continue;
+            X[unique] = X[i];
+            Y[unique] = Y[i];
+            unique++;
+        }
+        valid = unique;
+
+        if(valid < k)
+        {
+            memset(Y, 0, n);
+            failed++;
+            continue;
+        }
+        if(!correct || valid == k)
+            continue;
+
+        uint8_t polynomial[k];
+        lagrange_interpolation_into(polynomial, k, 1, &X, &Y);
+        if(keep_consistent_points(X, Y, valid, polynomial, k) == valid)
+            continue;
+        if(berlekamp_welch(X, Y, valid, k, polynomial) == 0)
+            keep_consistent_points(X, Y, valid, polynomial, k);
+        else
+        {
+            memset(Y, 0, n);
+            failed++;
         }
     }
-    free_xwvu_blocks(album, images, k, n);
-    return points;
+    free_xwvu_blocks_range(album, n, count);
+    *Xs = points_X;
+    *Ys = points_Y;
+    return failed;
 }
 
-uint8_t ** lagrange_interpolation(int k, int block_count, uint8_t** Xs, uint8_t** Ys) {
-    uint8_t** polynomials = calloc(block_count, sizeof(uint8_t*));
+// Interpolates a batch of blocks, writing the k coefficients of each block's polynomial to out[block*k]
+// Every block shares the master polynomial P(x) = (x+X0)...(x+Xk-1), so each Lagrange basis numerator is just
+// P(x)/(x+Xi) (synthetic division), and all the batch's denominators are inverted together with a single inversion.
+static void lagrange_batch(uint8_t* out, int k, int batch, uint8_t** Xs, uint8_t** Ys)
+{
+    uint8_t master[batch][k+1];
+    uint8_t weights[batch*k];
 
-    for(int block=0; block < block_count; block++) {
-        
-        polynomials[block] = calloc(k, sizeof(uint8_t));
-        for(int m = 0; m<k; m++) {
-            polynomials[block][m] = 0;
+    for(int b=0; b < batch; b++)
+    {
+        uint8_t* X = Xs[b];
+        master[b][0] = 1;
+        for(int j=0; j < k; j++)
+        {
+            master[b][j+1] = master[b][j];
+            for(int m=j; m > 0; m--)
+                master[b][m] = galois_sum(master[b][m-1], galois_multiply(master[b][m], X[j]));
+            master[b][0] = galois_multiply(master[b][0], X[j]);
         }
-
-        for(int i = 0; i<k; i++){
-            uint8_t poli[k];
+        for(int i=0; i < k; i++)
+        {
             uint8_t det = 1;
-            int n = 0;
-
-            for (int j = 0; j<k; j++){
-                if(i != j){
-                    det = galois_multiply(det,galois_sum(Xs[block][i], Xs[block][j]));
-                    
-                    if (n == 0) {
-                        poli[0] = galois_multiply(Xs[block][j], Ys[block][i]);
-                        poli[1] =  Ys[block][i];
-                    }
-
-                    else {
-                        for(int m=n; m>=0; m--) {
-                            poli[m+1] = poli[m];
-                        }
-                        poli[0] = galois_multiply(poli[0], Xs[block][j]);
-                        for(int m=1; m<=n; m++) {
-                            poli[m] = galois_sum(poli[m], galois_multiply(poli[m+1], Xs[block][j]));
-                        }
-                    }
-                    n++;
-                }
+            for(int j=0; j < k; j++)
+                if(i != j)
+                    det = galois_multiply(det, galois_sum(X[i], X[j]));
+            weights[b*k + i] = det;
+        }
+    }
 
-            }
-            for(int m = 0; m<k; m++) {
-                polynomials[block][m] = galois_sum(polynomials[block][m], galois_divide(poli[m],det));
-            }
+    galois_batch_inverse(weights, batch*k);
 
+    for(int b=0; b < batch; b++)
+    {
+        uint8_t* X = Xs[b];
+        uint8_t* Y = Ys[b];
+        uint8_t* coefficients = out + b*k;
+        uint8_t quotient[k];
+        memset(coefficients, 0, k);
+        for(int i=0; i < k; i++)
+        {
+            uint8_t weight = galois_multiply(Y[i], weights[b*k + i]);
+            quotient[k-1] = master[b][k];
+            for(int m=k-1; m > 0; m--)
+                quotient[m-1] = galois_sum(master[b][m], galois_multiply(X[i], quotient[m]));
+            for(int m=0; m < k; m++)
+                coefficients[m] = galois_sum(coefficients[m], galois_multiply(weight, quotient[m]));
         }
     }
-    return polynomials;
 }
 
-void recover_image(image_t img, char* filename, uint8_t**polynomials, int k, int block_count) {
-    for(int i =0; i<block_count; i++){
-        for(int j =0; j<k; j++){
-            img.content[i*k+j] = polynomials[i][j];
-        }
+// Interpolates every block and writes the coefficients straight into the recovered pixel layout
+void lagrange_interpolation_into(uint8_t* content, int k, int block_count, uint8_t** Xs, uint8_t** Ys)
+{
+    for(int block=0; block < block_count; block += LAGRANGE_BATCH)
+    {
+        int batch = block_count - block < LAGRANGE_BATCH ? block_count - block : LAGRANGE_BATCH;
+        lagrange_batch(content + block*k, k, batch, Xs + block, Ys + block);
     }
-    save_file_as(img, filename);
 }
 
 void free_points(uint8_t** points, int block_count)
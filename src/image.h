@@ -3,6 +3,7 @@
 #include <stdint.h>
 #define BYTES_PER_PIXEL 8
 #define MAX_CAMOUFLAGE_BUFFER 25
+#define LAGRANGE_BATCH 32 // Blocks interpolated together, sharing a single GF(256) inversion
 
 typedef struct {
 	char* filename;
@@ -11,8 +12,11 @@ typedef struct {
 	int height;
 	int real_width;
     uint8_t* content;
+    uint8_t* packed; // Bit-packed XWVU blocks if loaded from a shadow container, NULL for bitmaps
 } image_t;
 
+int read_little_endian_int(uint8_t* bytes);
+void write_little_endian_int(uint8_t* bytes, int value);
 image_t load_image(char* filename);
 void free_image(image_t image);
 void print_picture(image_t image);
@@ -20,16 +24,20 @@ int collect_images(DIR* FD, char* dir_name, int k, image_t** pics);
 void free_picture_album(image_t* pictures, int size);
 void save_file(image_t image);
 void save_file_as(image_t image, char* filename);
-uint8_t** get_secret_blocks(image_t image, int k);
-void free_secret_blocks(uint8_t** blocks, image_t image, int k);
+image_t blank_image(image_t template);
 
+int xwvu_block_offset(image_t image, int j);
 uint8_t*** get_xwvu_blocks(image_t* images, int k, int n);
+uint8_t*** get_xwvu_blocks_range(image_t* images, int n, int first, int count);
+void adjust_xwvu_blocks(uint8_t*** album, int block_count, int n);
 void transform_xwvu_blocks(uint8_t*** album, uint8_t** polynomials, int block_count, int k, int n);
+void transform_indexed_blocks(image_t* pictures, uint8_t** xs, uint8_t** polynomials, int k, int n, int first, int count);
 void replace_xwvu_blocks(uint8_t*** album, image_t* pictures, int k, int n);
+void replace_xwvu_blocks_range(uint8_t*** album, image_t* pictures, int n, int first, int count);
 void free_xwvu_blocks(uint8_t*** album, image_t* images, int k, int n);
-uint8_t** recover_points(image_t* images, int k, int n, int dim);
-uint8_t ** lagrange_interpolation(int k, int block_count, uint8_t** Xs, uint8_t** Ys);
-void recover_image(image_t img, char* filename, uint8_t**polynomials, int k, int block_count);
+void free_xwvu_blocks_range(uint8_t*** album, int n, int count);
+int recover_valid_points(image_t* images, int k, int n, int first, int count, int correct, uint8_t*** Xs, uint8_t*** Ys);
+void lagrange_interpolation_into(uint8_t* content, int k, int block_count, uint8_t** Xs, uint8_t** Ys);
 void free_points(uint8_t** points, int block_count);
 
 #endif
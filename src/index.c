@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "index.h"
+
+static char* base_name(char* filename)
+{
+    char* slash = strrchr(filename, '/');
+    return slash == NULL ? filename : slash + 1;
+}
+
+// Writes size, mtime seconds (8 bytes) and mtime nanoseconds of filename. Returns -1 if it can't be read.
+static int write_fingerprint(uint8_t* bytes, char* filename)
+{
+    struct stat info;
+    if(stat(filename, &info) != 0)
+        return -1;
+    long long seconds = info.st_mtim.tv_sec;
+    write_little_endian_int(bytes, info.st_size);
+    write_little_endian_int(bytes+4, seconds & 0xFFFFFFFF);
+    write_little_endian_int(bytes+8, seconds >> 32);
+    write_little_endian_int(bytes+12, info.st_mtim.tv_nsec);
+    return 0;
+}
+
+int save_index(char* filename, image_t* pictures, uint8_t** xs, int k, int n)
+{
+    int block_count = (pictures[0].height*pictures[0].width)/k;
+    size_t size = INDEX_HEADER_SIZE + (size_t) n*block_count;
+    for(int i=0; i < n; i++)
+        size += 2 + strlen(base_name(pictures[i].filename)) + 16;
+
+    uint8_t* index = calloc(size, sizeof(uint8_t));
+    memcpy(index, INDEX_MAGIC, 4);
+    index[4] = INDEX_VERSION;
+    index[5] = k;
+    write_little_endian_int(index+8, pictures[0].width);
+    write_little_endian_int(index+12, pictures[0].height);
+    write_little_endian_int(index+16, pictures[0].real_width);
+    write_little_endian_int(index+20, n);
+    write_little_endian_int(index+24, block_count);
+
+    uint8_t* entry = index + INDEX_HEADER_SIZE;
+    for(int i=0; i < n; i++)
+    {
+        char* name = base_name(pictures[i].filename);
+        int len = strlen(name);
+        entry[0] = len & 0xFF;
+        entry[1] = (len >> 8) & 0xFF;
+        memcpy(entry+2, name, len);
+        if(write_fingerprint(entry + 2 + len, pictures[i].filename) < 0)
+        {
+            fprintf(stderr, "ERROR. Picture %s could not be read.\n", pictures[i].filename);
+            free(index);
+            return EXIT_FAILURE;
+        }
+        entry += 2 + len + 16;
+    }
+    for(int i=0; i < n; i++)
+        memcpy(entry + (size_t) i*block_count, xs[i], block_count);
+
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "ERROR. Index %s could not be created.\n", filename);
+        free(index);
+        return EXIT_FAILURE;
+    }
+    fwrite(index, sizeof(uint8_t), size, file);
+    fclose(file);
+    free(index);
+    return EXIT_SUCCESS;
+}
+
+// Extracts the X of every block and makes them unique, just like distribution would
+int build_index(char* filename, image_t* pictures, int k, int n)
+{
+    int block_count = (pictures[0].height*pictures[0].width)/k;
+    uint8_t*** album = get_xwvu_blocks(pictures, k, n);
+    adjust_xwvu_blocks(album, block_count, n);
+    uint8_t** xs = calloc(n, sizeof(uint8_t*));
+    for(int i=0; i < n; i++)
+    {
+        xs[i] = calloc(block_count, sizeof(uint8_t));
+        for(int j=0; j < block_count; j++)
+            xs[i][j] = album[i][j][0];
+    }
+    free_xwvu_blocks(album, pictures, k, n);
+    int status = save_index(filename, pictures, xs, k, n);
+    free_points(xs, n);
+    return status;
+}
+
+// Returns xs[picture][block] in the same order as pictures, or NULL if the index is missing or out of date
+uint8_t** load_index(char* filename, image_t* pictures, int k, int n)
+{
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "WARNING. Index %s could not be opened, it will be ignored.\n", filename);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* index = NULL;
+    if(len >= INDEX_HEADER_SIZE && (index = malloc(len)) != NULL && fread(index, 1, len, file) != (size_t) len)
+    {
+        free(index);
+        index = NULL;
+    }
+    fclose(file);
+
+    int block_count = (pictures[0].height*pictures[0].width)/k;
+    if(index == NULL || memcmp(index, INDEX_MAGIC, 4) != 0 || index[4] != INDEX_VERSION || index[5] != k
+        || read_little_endian_int(index+8) != pictures[0].width || read_little_endian_int(index+12) != pictures[0].height
+        || read_little_endian_int(index+16) != pictures[0].real_width || read_little_endian_int(index+20) != n
+        || read_little_endian_int(index+24) != block_count)
+    {
+        fprintf(stderr, "WARNING. Index %s doesn't match this job, it will be ignored.\n", filename);
+        free(index);
+        return NULL;
+    }
+
+    // positions[picture] is the entry it matched, which is also where its Xs are stored
+    int positions[n];
+    for(int i=0; i < n; i++)
+        positions[i] = -1;
+    uint8_t* entry = index + INDEX_HEADER_SIZE;
+    uint8_t* end = index + len;
+    int valid = 1;
+    for(int e=0; e < n && valid; e++)
+    {
+        int name_len = entry + 2 <= end ? entry[0] | entry[1] << 8 : -1;
+        valid = name_len >= 0 && entry + 2 + name_len + 16 <= end;
+        for(int i=0; i < n && valid; i++)
+        {
+            char* name = base_name(pictures[i].filename);
+            if(positions[i] >= 0 || (int) strlen(name) != name_len || memcmp(entry+2, name, name_len) != 0)
+                continue;
+            uint8_t fingerprint[16];
+            if(write_fingerprint(fingerprint, pictures[i].filename) == 0 && memcmp(fingerprint, entry + 2 + name_len, 16) == 0)
+                positions[i] = e;
+            break;
+        }
+        entry += 2 + name_len + 16;
+    }
+    for(int i=0; i < n && valid; i++)
+        valid = positions[i] >= 0;
+    if(!valid || entry + (size_t) n*block_count != end)
+    {
+        fprintf(stderr, "WARNING. Index %s is out of date, it will be ignored.\n", filename);
+        free(index);
+        return NULL;
+    }
+
+    uint8_t** xs = calloc(n, sizeof(uint8_t*));
+    for(int i=0; i < n; i++)
+    {
+        xs[i] = calloc(block_count, sizeof(uint8_t));
+        memcpy(xs[i], entry + (size_t) positions[i]*block_count, block_count);
+    }
+    free(index);
+    return xs;
+}
@@ -0,0 +1,20 @@
+#ifndef INDEX_H
+#define INDEX_H
+#include <stdint.h>
+#include <dirent.h>
+#include "image.h"
+#define INDEX_MAGIC "SSIX"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 28
+
+// A camouflage index holds everything distribution computes from the camouflage pictures alone:
+// header | one entry per picture | X of every block of every picture, already unique within each block set
+// The header is INDEX_MAGIC, version, k, 2 reserved bytes, width, height, real width, amount of pictures and block count.
+// Each entry is the picture's name length (2 bytes) and name, followed by its size and modification time
+// (seconds, 8 bytes, and nanoseconds), which invalidate the index if the picture is modified by anyone else.
+
+int build_index(char* filename, image_t* pictures, int k, int n);
+uint8_t** load_index(char* filename, image_t* pictures, int k, int n);
+int save_index(char* filename, image_t* pictures, uint8_t** xs, int k, int n);
+
+#endif
@@ -6,8 +6,12 @@
 #include <errno.h>
 #include "image.h"
 #include "galois.h"
+#include "fragment.h"
+#include "container.h"
+#include "index.h"
+#include "planner.h"
 
-enum mode{DISTRIBUTE, RECOVER};
+enum mode{DISTRIBUTE, RECOVER, MERGE, PACK, INDEX};
 typedef struct args{
 	enum mode selected_mode;
 	image_t image;
@@ -17,19 +21,98 @@ typedef struct args{
 	DIR* dir;
 	image_t* pictures;
 	char* filename;
+	int partial;
+	int first_block;
+	int last_block;
+	int correct;
+	char* index_name;
+	int verbose;
+	plan_t plan;
 } args_t;
 
+// Everything a chunk of blocks needs to be distributed or recovered, shared by all workers
+typedef struct job{
+	args_t* args;
+	uint8_t** xs;
+	image_t output;
+} job_t;
+
 int parse_args(int argc, char* argv[], args_t* args)
 {
 	args->dir = NULL;
 	args->image.file = NULL;
 	args->pictures = NULL;
-	if(argc != 5)
+	args->partial = 0;
+	args->correct = 0;
+	args->index_name = NULL;
+	args->verbose = 0;
+	args->plan = (plan_t){AUTOMATIC, 0, 0, 0, 0, 0};
+	if(argc < 5)
 	{
 		fprintf(stderr, "ERROR. Program expected 4 arguments, but received only %d.\n", argc-1);
 		return EXIT_FAILURE;
 	}
 
+	// Optional flags after the 4 arguments
+	for(int i=5; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-b") == 0 && i+1 < argc)
+		{
+			if(sscanf(argv[++i], "%d:%d", &args->first_block, &args->last_block) != 2)
+			{
+				fprintf(stderr, "ERROR. Block range should be written as FIRST:LAST but received %s.\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			args->partial = 1;
+		}
+		else if(strcmp(argv[i], "-e") == 0)
+		{
+			args->correct = 1;
+		}
+		else if(strcmp(argv[i], "-i") == 0 && i+1 < argc)
+		{
+			args->index_name = argv[++i];
+		}
+		else if(strcmp(argv[i], "-v") == 0)
+		{
+			args->verbose = 1;
+		}
+		else if(strcmp(argv[i], "-s") == 0 && i+1 < argc)
+		{
+			i++;
+			if(strcmp(argv[i], "memory") == 0)
+				args->plan.strategy = IN_MEMORY;
+			else if(strcmp(argv[i], "stream") == 0)
+				args->plan.strategy = STREAMING;
+			else if(strcmp(argv[i], "threads") == 0)
+				args->plan.strategy = THREADED;
+			else
+			{
+				fprintf(stderr, "ERROR. Strategy should be either 'memory', 'stream' or 'threads' but received %s.\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if((strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "-c") == 0) && i+1 < argc)
+		{
+			int value = atoi(argv[i+1]);
+			if(value <= 0)
+			{
+				fprintf(stderr, "ERROR. %s should be followed by a positive integer but received %s.\n", argv[i], argv[i+1]);
+				return EXIT_FAILURE;
+			}
+			if(strcmp(argv[i], "-w") == 0)
+				args->plan.workers = value;
+			else
+				args->plan.chunk_blocks = value;
+			i++;
+		}
+		else
+		{
+			fprintf(stderr, "ERROR. Unknown option %s.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
 	// ARG 1 - d or r
 	if(strcmp(argv[1], "d") == 0)
 	{
@@ -39,14 +122,48 @@ int parse_args(int argc, char* argv[], args_t* args)
 	{
 		args->selected_mode = RECOVER;
 	}
+	else if(strcmp(argv[1], "m") == 0)
+	{
+		args->selected_mode = MERGE;
+	}
+	else if(strcmp(argv[1], "p") == 0)
+	{
+		args->selected_mode = PACK;
+	}
+	else if(strcmp(argv[1], "i") == 0)
+	{
+		args->selected_mode = INDEX;
+	}
 	else
 	{
-		fprintf(stderr, "ERROR. First argument should be either 'd' or 'r' but received %s.\n", argv[1]);
+		fprintf(stderr, "ERROR. First argument should be either 'd', 'r', 'm', 'p' or 'i' but received %s.\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	if(args->selected_mode != DISTRIBUTE && args->selected_mode != RECOVER && args->partial)
+	{
+		fprintf(stderr, "ERROR. Block ranges can only be used when distributing or recovering.\n");
+		return EXIT_FAILURE;
+	}
+	if(args->selected_mode != RECOVER && args->correct)
+	{
+		fprintf(stderr, "ERROR. Error correction can only be used when recovering.\n");
+		return EXIT_FAILURE;
+	}
+	if(args->selected_mode != DISTRIBUTE && args->selected_mode != RECOVER && (args->verbose || args->plan.strategy != AUTOMATIC
+		|| args->plan.workers > 0 || args->plan.chunk_blocks > 0))
+	{
+		fprintf(stderr, "ERROR. Execution plan options can only be used when distributing or recovering.\n");
+		return EXIT_FAILURE;
+	}
+	if(args->selected_mode != DISTRIBUTE && args->index_name != NULL)
+	{
+		fprintf(stderr, "ERROR. Camouflage indexes can only be used when distributing.\n");
 		return EXIT_FAILURE;
 	}
 
-	// ARG 2 - Original image file (Input if d, Output if r)
+	// ARG 2 - Original image file (Input if d, Output if r or m, output directory if p, index file if i)
 	FILE* file;
+	DIR* output_dir;
 	args->filename = argv[2];
 
 	switch (args->selected_mode)
@@ -60,6 +177,7 @@ int parse_args(int argc, char* argv[], args_t* args)
 			}
 			break;
 		case RECOVER:
+		case MERGE:
 		    if(file = fopen(args->filename, "r"))
 		    {
 				fprintf(stderr, "ERROR. File %s already exists. Please choose another filename to avoid overwriting it!\n", args->filename);
@@ -67,6 +185,16 @@ int parse_args(int argc, char* argv[], args_t* args)
 				return EXIT_FAILURE;
 		    }
 			break;
+		case PACK:
+			if((output_dir = opendir(args->filename)) == NULL)
+			{
+				fprintf(stderr, "ERROR. Directory %s could not be opened.\n", args->filename);
+				return EXIT_FAILURE;
+			}
+			closedir(output_dir);
+			break;
+		case INDEX:
+			break;
 		default:
 			return EXIT_FAILURE;
 	}
@@ -92,6 +220,17 @@ int parse_args(int argc, char* argv[], args_t* args)
 		args->n = collect_images(args->dir, args->dir_name, args->k, &(args->pictures));
 		if(args->k > args->n)
 			return EXIT_FAILURE;
+		if(args->selected_mode == DISTRIBUTE || args->selected_mode == PACK || args->selected_mode == INDEX)
+		{
+			for(int i=0; i < args->n; i++)
+			{
+				if(args->pictures[i].packed != NULL)
+				{
+					fprintf(stderr, "ERROR. %s is a shadow container, which can only be used for recovery.\n", args->pictures[i].filename);
+					return EXIT_FAILURE;
+				}
+			}
+		}
 		if(args->selected_mode == DISTRIBUTE)
 		{
 			if(args->image.real_width != args->pictures[0].real_width)
@@ -105,6 +244,17 @@ int parse_args(int argc, char* argv[], args_t* args)
 				return EXIT_FAILURE;
 			}
 		}
+		int block_count = (args->pictures[0].height*args->pictures[0].width)/args->k;
+		if(!args->partial)
+		{
+			args->first_block = 0;
+			args->last_block = block_count;
+		}
+		else if(args->first_block < 0 || args->first_block >= args->last_block || args->last_block > block_count)
+		{
+			fprintf(stderr, "ERROR. Block range %d:%d is not within the %d blocks of this job.\n", args->first_block, args->last_block, block_count);
+			return EXIT_FAILURE;
+		}
 		return EXIT_SUCCESS;
 	}
 	else if (ENOENT == errno)
@@ -120,6 +270,41 @@ int parse_args(int argc, char* argv[], args_t* args)
 	return EXIT_SUCCESS;
 }
 
+// Distributes blocks first..first+count-1 of the secret into the pictures in memory
+int distribute_chunk(void* data, int first, int count)
+{
+	job_t* job = data;
+	args_t* args = job->args;
+	uint8_t** B = calloc(count, sizeof(uint8_t*));
+	for(int j=0; j < count; j++)
+		B[j] = args->image.content + (first + j)*args->k;
+	if(job->xs != NULL)
+		transform_indexed_blocks(args->pictures, job->xs, B, args->k, args->n, first, count);
+	else
+	{
+		uint8_t*** xwvu_album = get_xwvu_blocks_range(args->pictures, args->n, first, count);
+		transform_xwvu_blocks(xwvu_album, B, count, args->k, args->n);
+		replace_xwvu_blocks_range(xwvu_album, args->pictures, args->n, first, count);
+		free_xwvu_blocks_range(xwvu_album, args->n, count);
+	}
+	free(B);
+	return 0;
+}
+
+// Recovers blocks first..first+count-1 into the output picture. Returns how many blocks couldn't be recovered.
+int recover_chunk(void* data, int first, int count)
+{
+	job_t* job = data;
+	args_t* args = job->args;
+	uint8_t** points_X;
+	uint8_t** points_Y;
+	int failed = recover_valid_points(args->pictures, args->k, args->n, first, count, args->correct, &points_X, &points_Y);
+	lagrange_interpolation_into(job->output.content + first*args->k, args->k, count, points_X, points_Y);
+	free_points(points_X, count);
+	free_points(points_Y, count);
+	return failed;
+}
+
 int main(int argc, char* argv[])
 {
 	args_t args;
@@ -134,36 +319,116 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 	load_multiplication_table();
-	int block_count;
+	load_power_table(args.k);
+	int status = EXIT_SUCCESS;
+	int block_count = (args.pictures[0].height*args.pictures[0].width)/args.k;
+	int count = args.last_block - args.first_block;
+	job_t job = {&args, NULL, args.pictures[0]};
+	if(args.selected_mode == DISTRIBUTE || args.selected_mode == RECOVER)
+	{
+		args.plan = make_plan(args.pictures, args.n, count, args.selected_mode == RECOVER, args.plan);
+		if(args.verbose)
+			print_plan(args.plan, count);
+	}
 	if(args.selected_mode == DISTRIBUTE)
 	{
-		block_count = (args.image.height*args.image.width)/args.k;
-		uint8_t** B = get_secret_blocks(args.image, args.k);
-		uint8_t*** xwvu_album = get_xwvu_blocks(args.pictures, args.k, args.n);
-		transform_xwvu_blocks(xwvu_album, B, block_count, args.k, args.n);
-		replace_xwvu_blocks(xwvu_album, args.pictures, args.k, args.n);
-		for(int i=0; i < args.n; i++)
-			save_file(args.pictures[i]);
-		free_secret_blocks(B, args.image, args.k);
-		free_xwvu_blocks(xwvu_album, args.pictures, args.k, args.n);
+		job.xs = args.index_name == NULL ? NULL : load_index(args.index_name, args.pictures, args.k, args.n);
+		run_plan(args.plan, args.first_block, count, distribute_chunk, &job);
+		if(args.partial)
+			status = save_shadow_fragments(args.pictures, args.k, args.n, args.first_block, count);
+		else
+		{
+			for(int i=0; i < args.n; i++)
+				save_file(args.pictures[i]);
+			// Saving the pictures changed their fingerprints, but not their Xs, so the index is still good
+			if(job.xs != NULL)
+				status = save_index(args.index_name, args.pictures, job.xs, args.k, args.n);
+		}
+		if(job.xs != NULL)
+			free_points(job.xs, args.n);
+	}
+	else if(args.selected_mode == INDEX)
+	{
+		status = build_index(args.filename, args.pictures, args.k, args.n);
+	}
+	else if(args.selected_mode == PACK)
+	{
+		for(int i=0; i < args.n && status == EXIT_SUCCESS; i++)
+			status = save_container(args.pictures[i], i, args.k, args.filename);
+	}
+	else if(args.selected_mode == RECOVER)
+	{
+		// The secret goes in its own buffer, since writing it over a shadow would clobber blocks other chunks still have to read
+		job.output = blank_image(args.pictures[0]);
+		int failed = run_plan(args.plan, args.first_block, count, recover_chunk, &job);
+		if(failed > 0)
+		{
+			fprintf(stderr, "ERROR. %d blocks had too many corrupted shadows and were recovered as black pixels.\n", failed);
+			status = EXIT_FAILURE;
+		}
+		uint8_t* recovered = job.output.content + args.first_block*args.k;
+		if(args.partial)
+		{
+			if(save_fragment(args.filename, SECRET_FRAGMENT, job.output, args.k, args.first_block, count, recovered) != EXIT_SUCCESS)
+				status = EXIT_FAILURE;
+		}
+		else
+			save_file_as(job.output, args.filename);
+		free(job.output.file);
 	}
 	else
 	{
-		block_count = (args.pictures[0].height*args.pictures[0].width)/args.k;
-		uint8_t** points_X = recover_points(args.pictures, args.k, args.n, 0);
-		uint8_t** points_Y = recover_points(args.pictures, args.k, args.n, 1);
-		//TODO: agregar random a lagrange para q agarre distintos puntos
-		uint8_t** polynomials = lagrange_interpolation(args.k, block_count, points_X, points_Y);
-		recover_image(args.pictures[0], args.filename, polynomials, args.k, block_count);
-		free_points(points_X, block_count);
-		free_points(points_Y, block_count);
-		free_points(polynomials, block_count);
+		// Shadows first, since the recovered secret is assembled on top of the first shadow's buffer
+		int merged_files = 0;
+		for(int i=0; i < args.n && status == EXIT_SUCCESS; i++)
+		{
+			if(args.pictures[i].packed != NULL)
+				continue;
+			int merged = merge_fragments(args.pictures[i].filename, SHADOW_FRAGMENT, args.pictures[i], args.k);
+			if(merged < 0 || (merged > 0 && merged < block_count))
+			{
+				if(merged > 0)
+					fprintf(stderr, "ERROR. Fragments of %s only cover %d of its %d blocks.\n", args.pictures[i].filename, merged, block_count);
+				status = EXIT_FAILURE;
+			}
+			else if(merged > 0)
+			{
+				save_file(args.pictures[i]);
+				remove_fragments(args.pictures[i].filename);
+				merged_files++;
+			}
+		}
+		image_t output = args.pictures[0].packed == NULL ? args.pictures[0] : blank_image_from_container(args.pictures[0]);
+		if(status == EXIT_SUCCESS)
+		{
+			int merged = merge_fragments(args.filename, SECRET_FRAGMENT, output, args.k);
+			if(merged < 0 || (merged > 0 && merged < block_count))
+			{
+				if(merged > 0)
+					fprintf(stderr, "ERROR. Fragments of %s only cover %d of its %d blocks.\n", args.filename, merged, block_count);
+				status = EXIT_FAILURE;
+			}
+			else if(merged > 0)
+			{
+				save_file_as(output, args.filename);
+				remove_fragments(args.filename);
+				merged_files++;
+			}
+		}
+		if(output.file != args.pictures[0].file)
+			free(output.file);
+		if(status == EXIT_SUCCESS && merged_files == 0)
+		{
+			fprintf(stderr, "ERROR. No fragments were found for %s or the pictures in %s.\n", args.filename, args.dir_name);
+			status = EXIT_FAILURE;
+		}
 	}
 
 	// CLEANUP
 	free_picture_album(args.pictures, args.n);
 	free(args.image.file);
 	closedir(args.dir);
+	free_power_table();
 	free_multiplication_table();
-	return EXIT_SUCCESS;
+	return status;
 }
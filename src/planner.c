@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "planner.h"
+
+static const char* strategy_names[] = {"automatic", "in-memory", "streaming", "threaded"};
+
+// Memory needed per block in flight: every shadow's XWVU block, plus the points and polynomial of the block
+static size_t block_footprint(int n, int recovering)
+{
+	if(recovering)
+		return n*TILE_FOOTPRINT + 2*(n + TILE_FOOTPRINT);
+	return n*TILE_FOOTPRINT + sizeof(uint8_t*);
+}
+
+static int round_chunk(int chunk, int count)
+{
+	chunk -= chunk % LAGRANGE_BATCH;
+	if(chunk < MIN_CHUNK_BLOCKS)
+		chunk = MIN_CHUNK_BLOCKS;
+	return chunk > count ? count : chunk;
+}
+
+// Estimates the footprint of the job from the picture headers and picks a strategy for this machine.
+// Anything set in overrides (strategy, chunk_blocks or workers) is kept as is.
+plan_t make_plan(image_t* pictures, int n, int count, int recovering, plan_t overrides)
+{
+	plan_t plan = overrides;
+	long pages = sysconf(_SC_AVPHYS_PAGES);
+	long page_size = sysconf(_SC_PAGESIZE);
+	plan.available_memory = (pages > 0 && page_size > 0) ? (size_t) pages * page_size : (size_t) 1 << 30;
+	plan.cores = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+	// The pictures (and the secret or recovered picture) are always fully loaded
+	size_t pictures_memory = (size_t)(n + 1) * pictures[0].width * pictures[0].height;
+	size_t per_block = block_footprint(n, recovering);
+	size_t budget = plan.available_memory / 2;
+	size_t working_budget = budget > pictures_memory ? budget - pictures_memory : 0;
+	size_t fitting = working_budget / per_block;
+	if(fitting > (size_t) count)
+		fitting = count;
+	int fitting_blocks = fitting;
+
+	if(plan.workers <= 0)
+	{
+		if(plan.strategy == IN_MEMORY || plan.strategy == STREAMING)
+			plan.workers = 1;
+		else
+		{
+			plan.workers = count / MIN_BLOCKS_PER_WORKER;
+			if(plan.workers > plan.cores)
+				plan.workers = plan.cores;
+			if(plan.workers < 1)
+				plan.workers = 1;
+			if(plan.strategy == THREADED && plan.workers < 2)
+				plan.workers = plan.cores > 1 ? plan.cores : 2;
+		}
+	}
+	// A forced strategy wins over -w and -c when they contradict it
+	if(plan.strategy == IN_MEMORY || plan.strategy == STREAMING)
+		plan.workers = 1;
+	if(plan.strategy == IN_MEMORY)
+		plan.chunk_blocks = count;
+
+	if(plan.chunk_blocks <= 0)
+	{
+		if(plan.strategy == IN_MEMORY || (plan.workers == 1 && fitting_blocks == count && plan.strategy != STREAMING))
+			plan.chunk_blocks = count;
+		else if(plan.workers == 1)
+			plan.chunk_blocks = round_chunk(fitting_blocks, count);
+		else
+		{
+			// A few chunks per worker keeps them all busy until the end, as long as they fit in memory together
+			int chunk = count / (4 * plan.workers);
+			if(chunk > fitting_blocks / plan.workers)
+				chunk = fitting_blocks / plan.workers;
+			plan.chunk_blocks = round_chunk(chunk, count);
+		}
+	}
+	if(plan.chunk_blocks > count)
+		plan.chunk_blocks = count;
+	// Workers without a chunk of their own would just sit idle
+	int chunks = (count + plan.chunk_blocks - 1) / plan.chunk_blocks;
+	if(plan.workers > chunks)
+		plan.workers = chunks;
+
+	if(plan.strategy == AUTOMATIC)
+	{
+		if(plan.workers > 1)
+			plan.strategy = THREADED;
+		else
+			plan.strategy = plan.chunk_blocks < count ? STREAMING : IN_MEMORY;
+	}
+	int in_flight = plan.workers * plan.chunk_blocks < count ? plan.workers * plan.chunk_blocks : count;
+	plan.estimated_memory = pictures_memory + in_flight * per_block;
+	return plan;
+}
+
+void print_plan(plan_t plan, int count)
+{
+	int chunks = (count + plan.chunk_blocks - 1) / plan.chunk_blocks;
+	printf("Plan: %s, %d worker%s, %d chunk%s of up to %d blocks.\n", strategy_names[plan.strategy],
+		plan.workers, plan.workers == 1 ? "" : "s", chunks, chunks == 1 ? "" : "s", plan.chunk_blocks);
+	printf("Estimated memory: %zu MB of %zu MB available. %d cores online.\n",
+		plan.estimated_memory >> 20, plan.available_memory >> 20, plan.cores);
+}
+
+typedef struct {
+	plan_t plan;
+	int worker;
+	int first;
+	int count;
+	int (*process)(void* job, int first, int count);
+	void* job;
+	int result;
+} worker_t;
+
+// Worker w processes chunks w, w + workers, w + 2*workers... and adds up what process returns
+static void* run_worker(void* data)
+{
+	worker_t* worker = data;
+	int chunk = worker->plan.chunk_blocks;
+	worker->result = 0;
+	for(int start = worker->worker * chunk; start < worker->count; start += worker->plan.workers * chunk)
+	{
+		int size = worker->count - start < chunk ? worker->count - start : chunk;
+		worker->result += worker->process(worker->job, worker->first + start, size);
+	}
+	return NULL;
+}
+
+// Runs process over blocks first..first+count-1 as planned. Returns the sum of what every call to process returned.
+int run_plan(plan_t plan, int first, int count, int (*process)(void* job, int first, int count), void* job)
+{
+	worker_t* workers = calloc(plan.workers, sizeof(worker_t));
+	pthread_t* threads = calloc(plan.workers, sizeof(pthread_t));
+	int* started = calloc(plan.workers, sizeof(int));
+	for(int w=0; w < plan.workers; w++)
+	{
+		workers[w] = (worker_t){plan, w, first, count, process, job, 0};
+		started[w] = w > 0 && pthread_create(&threads[w], NULL, run_worker, &workers[w]) == 0;
+	}
+	int result = 0;
+	for(int w=0; w < plan.workers; w++)
+	{
+		// Worker 0 runs on this thread, as does any worker whose thread couldn't be started
+		if(started[w])
+			pthread_join(threads[w], NULL);
+		else
+			run_worker(&workers[w]);
+		result += workers[w].result;
+	}
+	free(workers);
+	free(threads);
+	free(started);
+	return result;
+}
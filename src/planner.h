@@ -0,0 +1,27 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+#include <stddef.h>
+#include <dirent.h>
+#include "image.h"
+#define TILE_FOOTPRINT 28 // A 4 byte XWVU block, its pointer and the allocator's overhead
+#define MIN_BLOCKS_PER_WORKER 16384 // Below this, starting a thread costs more than it saves
+#define MIN_CHUNK_BLOCKS (32*LAGRANGE_BATCH)
+
+enum strategy{AUTOMATIC, IN_MEMORY, STREAMING, THREADED};
+
+// How a job is run: its blocks are processed chunk_blocks at a time, chunks being split between workers.
+// IN_MEMORY is a single chunk, STREAMING a single worker going through chunks and THREADED several workers.
+typedef struct {
+	enum strategy strategy;
+	int chunk_blocks;
+	int workers;
+	size_t estimated_memory;
+	size_t available_memory;
+	int cores;
+} plan_t;
+
+plan_t make_plan(image_t* pictures, int n, int count, int recovering, plan_t overrides);
+void print_plan(plan_t plan, int count);
+int run_plan(plan_t plan, int first, int count, int (*process)(void* job, int first, int count), void* job);
+
+#endif